@@ -5,6 +5,11 @@
 #include <algorithm>
 #include <filesystem> // C++17
 #include <iomanip> 
+#include <queue>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 #define STB_IMAGE_IMPLEMENTATION
 #define _CRT_SECURE_NO_WARNINGS
@@ -53,6 +58,49 @@ struct HapticEvent {
     }
 };
 
+enum class EMixPolicy : uint8_t
+{
+  Max = 0, Priority = 1, SumClamp = 2
+};
+
+// One layer of the haptic mix (e.g. music, sound effects), played back together with the other tracks
+struct HapticTrack {
+    std::string file; // Name of the haptic .json file
+    std::vector<HapticEvent> events;
+    int priority = 0;
+    size_t next_event_index = 0;
+    ma_sound sound; // Only valid while is_sound_initialized
+    bool is_sound_initialized = false;
+};
+
+// Heap entry pointing at the next pending event of a track
+struct TrackCursor {
+    double timestamp = 0.0;
+    int track_index = 0;
+    bool operator>(const TrackCursor& other) const {
+        return timestamp > other.timestamp;
+    }
+};
+
+constexpr int MANUAL_SOURCE = -1; // Mixer source of the Left/Right Hand sliders, tracks use their index
+
+// One source's share of a finger's output
+struct MixContribution {
+    int source = MANUAL_SOURCE;
+    int strength = 0;
+    float duration = 0.f;
+    int priority = 0;
+    double expiry = 0.0; // When the source stops contributing, set once mixed
+};
+
+// Mixer state of a single finger
+struct MixSlot {
+    std::vector<MixContribution> pending; // Due this frame, one per source
+    std::vector<MixContribution> active;  // Still authored to play, including sources that currently lose the mix
+    int sent_strength = 0;  // Last packet written to the glove
+    double sent_expiry = 0.0;
+};
+
 // --- Global D3D variables ---
 static ID3D11Device *g_pd3dDevice = nullptr;
 static ID3D11DeviceContext *g_pd3dDeviceContext = nullptr;
@@ -78,24 +126,44 @@ constexpr float imagePadding = 25.f;
 static std::vector<FingerConfig> g_leftHandFingers;
 static std::vector<FingerConfig> g_rightHandFingers;
 const int NUM_FINGERS_PER_HAND = 5; 
+const int NUM_HANDS = 2;
 
 // --- Haptic Song Playback Globals ---
-static std::vector<HapticEvent> g_scheduled_events;
+static std::vector<HapticTrack> g_tracks; // Do not resize while playback is active, sounds are initialized in place
+static bool g_single_file_playback = false; // g_tracks only holds the selected file for this playback, cleared on stop
 static std::vector<std::string> g_available_haptic_files; // .json files
 static int g_current_selected_haptic_file_index = -1;
 static std::string g_haptic_files_directory = "haptic_outputs"; 
 static std::string g_audio_files_directory = "songs"; // Directory for audio files
 static bool g_playback_active = false;
 static double g_playback_start_time_global = 0.0; 
-static int g_next_event_index = 0;
-static std::string g_currently_playing_file = ""; // Name of the haptic .json file
 static char g_haptic_file_load_error[256] = ""; 
 static char g_audio_file_load_error[256] = ""; // For audio loading errors
 
+// --- Mixer Globals ---
+static std::priority_queue<TrackCursor, std::vector<TrackCursor>, std::greater<TrackCursor>> g_track_heap; // One cursor per track with events left
+static MixSlot g_mix_slots[NUM_HANDS][NUM_FINGERS_PER_HAND];
+static EMixPolicy g_finger_mix_policy[NUM_FINGERS_PER_HAND] = {EMixPolicy::Max, EMixPolicy::Max, EMixPolicy::Max, EMixPolicy::Max, EMixPolicy::Max};
+static int g_manual_priority = 100; // Priority of the Left/Right Hand sliders when mixed with tracks
+
+// --- Session Recorder Globals ---
+// Single producer (frame thread) / single consumer (writer thread) ring, so sending a packet never waits on file I/O
+constexpr size_t g_recorder_capacity = 1 << 14; // Power of two
+static HapticEvent g_recorder_ring[g_recorder_capacity];
+static std::atomic<size_t> g_recorder_head{0}; // Only advanced by the frame thread
+static std::atomic<size_t> g_recorder_tail{0}; // Only advanced by the writer thread
+static std::atomic<bool> g_recording_active{false};
+static std::atomic<bool> g_recorder_writer_done{false};
+static std::atomic<bool> g_recorder_write_failed{false};
+static std::thread g_recorder_writer;
+static std::chrono::steady_clock::time_point g_recording_start_time;
+static std::string g_recording_file = ""; // Name of the haptic .json file being written
+static size_t g_recorded_packet_count = 0;
+static size_t g_recorder_dropped_count = 0;
+static char g_recorder_error[256] = "";
+
 // --- Audio Playback Globals (miniaudio) ---
 static ma_engine g_audio_engine;
-static ma_sound g_current_song_sound; // Sound object for the current song
-static bool g_is_current_song_sound_initialized = false; // To track if g_current_song_sound is valid
 
 
 // --- Forward Declarations ---
@@ -108,10 +176,19 @@ bool LoadTextureFromFile(const char *file_name, ID3D11ShaderResourceView **out_s
 bool LoadTextureFromMemory(const void *data, size_t data_size, ID3D11ShaderResourceView **out_srv, int *out_width, int *out_height);
 std::string GetFingerText(ETargetHandLocation Location);
 ImVec4 LerpColorHSV(const ImVec4& srgbColor1, const ImVec4& srgbColor2, float t);
+std::string GetMixPolicyText(EMixPolicy Policy);
 void RefreshHapticFileList();
-bool LoadHapticEvents(const std::string& haptic_filename_without_path);
-bool LoadAndPrepareAudio(const std::string& haptic_filename_without_path); 
+bool LoadHapticEvents(const std::string& haptic_filename_without_path, std::vector<HapticEvent>& out_events);
+bool LoadAndPrepareAudio(const std::string& haptic_filename_without_path, HapticTrack& track); 
 void StopAndUnloadAudio(); 
+void StopPlayback();
+void MixEvent(int hand_id, uint8_t finger_id, int strength, float duration, int priority, int source);
+bool WinsMix(EMixPolicy Policy, const MixContribution& challenger, const MixContribution& holder);
+void FlushMixSlots(serialib& leftHand, serialib& rightHand);
+void StartRecording();
+void StopRecording();
+void RecordPacket(int hand_id, uint8_t finger_id, uint8_t strength, float duration);
+void RecorderWriterThread(fs::path file_path);
 
 
 // Main code
@@ -222,7 +299,6 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 
     ImVec2 screenSize = io.DisplaySize;
     
-    if (g_playback_active) { ImGui::BeginDisabled(); }
     // Left Hand Manual Control Window
     {
       ImGui::SetNextWindowPos(ImVec2(0.f, 0.f));
@@ -264,7 +340,6 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
        } else { ImGui::TextColored(ImVec4(1.f,0.f,0.f,1.f), "Right Hand: COM11 Not Open");}
       ImGui::End();
     }
-    if (g_playback_active) { ImGui::EndDisabled(); }
 
     // Hand Image Display Window
     {
@@ -317,38 +392,84 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
           }
           ImGui::EndCombo();
       }
+      ImGui::SameLine();
+      bool can_add_track = (g_current_selected_haptic_file_index != -1 && !g_playback_active);
+      if (!can_add_track) { ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f); ImGui::BeginDisabled(); }
+      if (ImGui::Button("Add Track")) {
+          HapticTrack track; track.file = g_available_haptic_files[g_current_selected_haptic_file_index];
+          g_tracks.push_back(track);
+          ImGui::DebugLog("Track added: %s\n", track.file.c_str());
+      }
+      if (!can_add_track) { ImGui::EndDisabled(); ImGui::PopStyleVar(); }
+
+      // Track list, higher priority wins for fingers using the Priority policy
+      int track_to_remove = -1;
+      for (int n = 0; n < g_tracks.size(); n++) {
+          ImGui::PushID(n);
+          ImGui::Text("Track %d: %s", n + 1, g_tracks[n].file.c_str()); ImGui::SameLine();
+          ImGui::PushItemWidth(100.f); ImGui::DragInt("Priority", &g_tracks[n].priority, 1.f, 0, 255); ImGui::PopItemWidth();
+          ImGui::SameLine();
+          if (g_playback_active) { ImGui::BeginDisabled(); }
+          if (ImGui::Button("Remove")) { track_to_remove = n; }
+          if (g_playback_active) { ImGui::EndDisabled(); }
+          ImGui::PopID();
+      }
+      if (track_to_remove != -1) { g_tracks.erase(g_tracks.begin() + track_to_remove); }
+      ImGui::PushItemWidth(100.f); ImGui::DragInt("Manual Priority", &g_manual_priority, 1.f, 0, 255); ImGui::PopItemWidth();
+
+      ImGui::Text("Mix Policy:");
+      for (int i = 0; i < NUM_FINGERS_PER_HAND; ++i) {
+          ImGui::PushID(i); ImGui::SameLine(); ImGui::PushItemWidth(110.f);
+          std::string policyLabel = GetFingerText(g_leftHandFingers[i].Location);
+          if (ImGui::BeginCombo(policyLabel.c_str(), GetMixPolicyText(g_finger_mix_policy[i]).c_str())) {
+              for (EMixPolicy policy : {EMixPolicy::Max, EMixPolicy::Priority, EMixPolicy::SumClamp}) {
+                  if (ImGui::Selectable(GetMixPolicyText(policy).c_str(), g_finger_mix_policy[i] == policy)) { g_finger_mix_policy[i] = policy; }
+              }
+              ImGui::EndCombo();
+          }
+          ImGui::PopItemWidth(); ImGui::PopID();
+      }
 
-      bool can_play = (g_current_selected_haptic_file_index != -1 && !g_playback_active);
+      bool can_play = ((!g_tracks.empty() || g_current_selected_haptic_file_index != -1) && !g_playback_active);
       if (!can_play) { ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f); ImGui::BeginDisabled(); }
       if (ImGui::Button("Play")) {
-          if (g_current_selected_haptic_file_index != -1) { 
-                bool haptics_struct_loaded_successfully = LoadHapticEvents(g_available_haptic_files[g_current_selected_haptic_file_index]);
-                bool audio_loaded_successfully = false;
-
-                if (haptics_struct_loaded_successfully) { 
-                    audio_loaded_successfully = LoadAndPrepareAudio(g_available_haptic_files[g_current_selected_haptic_file_index]);
-                }
-
-                if (haptics_struct_loaded_successfully && (!g_scheduled_events.empty() || audio_loaded_successfully)) {
-                    g_playback_active = true;
-                    g_playback_start_time_global = g_timeSinceStart;
-                    g_next_event_index = 0;
-                    g_currently_playing_file = g_available_haptic_files[g_current_selected_haptic_file_index];
-                    ImGui::DebugLog("Playback started for: %s\n", g_currently_playing_file.c_str());
-                    if (haptics_struct_loaded_successfully) g_haptic_file_load_error[0] = '\0';
-                    if (audio_loaded_successfully) g_audio_file_load_error[0] = '\0';
-
-                    if (g_is_current_song_sound_initialized && audio_loaded_successfully) { 
-                        ma_sound_seek_to_pcm_frame(&g_current_song_sound, 0); // Ensure starts from beginning
-                        ma_sound_start(&g_current_song_sound);
-                    }
-                } else {
-                    if (!haptics_struct_loaded_successfully) {
-                        ImGui::DebugLog("Failed to load haptic file structure: %s\n", g_available_haptic_files[g_current_selected_haptic_file_index].c_str());
-                    } else if (g_scheduled_events.empty() && !audio_loaded_successfully) {
-                        ImGui::DebugLog("Haptic file for %s is empty AND audio failed to load. Nothing to play.\n", g_available_haptic_files[g_current_selected_haptic_file_index].c_str());
-                    }
-                }
+          if (g_tracks.empty()) { // Plain single file playback
+              HapticTrack track; track.file = g_available_haptic_files[g_current_selected_haptic_file_index];
+              g_tracks.push_back(track);
+              g_single_file_playback = true;
+          }
+          bool anything_to_play = false;
+          std::string haptic_errors, audio_errors;
+          g_track_heap = {};
+          for (int n = 0; n < g_tracks.size(); n++) {
+              HapticTrack& track = g_tracks[n];
+              track.next_event_index = 0;
+              bool haptics_loaded = LoadHapticEvents(track.file, track.events);
+              if (g_haptic_file_load_error[0] != '\0') { haptic_errors += g_haptic_file_load_error; haptic_errors += " "; }
+              if (!haptics_loaded) {
+                  ImGui::DebugLog("Failed to load haptic file structure: %s\n", track.file.c_str());
+                  continue;
+              }
+              if (!LoadAndPrepareAudio(track.file, track)) { audio_errors += g_audio_file_load_error; audio_errors += " "; }
+              if (!track.events.empty()) { g_track_heap.push({track.events[0].timestamp, n}); }
+              if (!track.events.empty() || track.is_sound_initialized) { anything_to_play = true; }
+          }
+          strncpy_s(g_haptic_file_load_error, haptic_errors.c_str(), sizeof(g_haptic_file_load_error) - 1);
+          strncpy_s(g_audio_file_load_error, audio_errors.c_str(), sizeof(g_audio_file_load_error) - 1);
+
+          if (anything_to_play) {
+              g_playback_active = true;
+              g_playback_start_time_global = g_timeSinceStart;
+              ImGui::DebugLog("Playback started for %zu track(s).\n", g_tracks.size());
+              for (HapticTrack& track : g_tracks) {
+                  if (track.is_sound_initialized) {
+                      ma_sound_seek_to_pcm_frame(&track.sound, 0); // Ensure starts from beginning
+                      ma_sound_start(&track.sound);
+                  }
+              }
+          } else {
+              ImGui::DebugLog("No haptic events AND no audio loaded for any track. Nothing to play.\n");
+              StopPlayback();
           }
       }
       if (!can_play) { ImGui::EndDisabled(); ImGui::PopStyleVar(); }
@@ -359,22 +480,34 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
       if (!can_stop) { ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f); ImGui::BeginDisabled(); }
       if (ImGui::Button("Stop")) { 
           if (g_playback_active) { 
-              g_playback_active = false;
-              ImGui::DebugLog("Playback stopped for: %s\n", g_currently_playing_file.c_str());
-              StopAndUnloadAudio(); 
-              g_currently_playing_file = "";
+              ImGui::DebugLog("Playback stopped for %zu track(s).\n", g_tracks.size());
+              StopPlayback();
           }
       }
       if (!can_stop) { ImGui::EndDisabled(); ImGui::PopStyleVar(); }
 
-      ImGui::Text("Status: %s", g_playback_active ? ("Playing: " + g_currently_playing_file).c_str() : "Stopped");
+      ImGui::SameLine();
+      if (g_recording_active) {
+          if (ImGui::Button("Stop Recording")) { StopRecording(); }
+          ImGui::SameLine(); ImGui::TextColored(ImVec4(1.f, 0.f, 0.f, 1.f), "REC %s: %zu packets (%zu dropped)", g_recording_file.c_str(), g_recorded_packet_count, g_recorder_dropped_count);
+      } else {
+          bool can_record = !g_recorder_writer.joinable(); // Previous recording is still being written
+          if (!can_record) { ImGui::PushStyleVar(ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * 0.5f); ImGui::BeginDisabled(); }
+          if (ImGui::Button("Record")) { StartRecording(); }
+          if (!can_record) { ImGui::EndDisabled(); ImGui::PopStyleVar(); }
+      }
+
+      ImGui::Text("Status: %s", g_playback_active ? ("Playing: " + std::to_string(g_tracks.size()) + " track(s)").c_str() : "Stopped");
       if (g_playback_active) {
           ImGui::SameLine();
-          double total_duration = g_scheduled_events.empty() ? 0.0 : g_scheduled_events.back().timestamp;
-          if (g_is_current_song_sound_initialized) { 
-                float audio_len_sec = 0.0f;
-                ma_sound_get_length_in_seconds(&g_current_song_sound, &audio_len_sec);
-                if (audio_len_sec > total_duration) total_duration = audio_len_sec;
+          double total_duration = 0.0;
+          for (HapticTrack& track : g_tracks) {
+              if (!track.events.empty() && track.events.back().timestamp > total_duration) total_duration = track.events.back().timestamp;
+              if (track.is_sound_initialized) { 
+                    float audio_len_sec = 0.0f;
+                    ma_sound_get_length_in_seconds(&track.sound, &audio_len_sec);
+                    if (audio_len_sec > total_duration) total_duration = audio_len_sec;
+              }
           }
           if (total_duration < (g_timeSinceStart - g_playback_start_time_global) && total_duration > 0) total_duration = (g_timeSinceStart - g_playback_start_time_global);
           ImGui::Text("Time: %.2f / %.2f s", (g_timeSinceStart - g_playback_start_time_global), total_duration);
@@ -383,6 +516,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
       }
        if (g_haptic_file_load_error[0] != '\0') { ImGui::TextColored(ImVec4(1.f, 0.f, 0.f, 1.f), "Haptic Error: %s", g_haptic_file_load_error); }
        if (g_audio_file_load_error[0] != '\0') { ImGui::TextColored(ImVec4(1.f, 0.f, 0.f, 1.f), "Audio Error: %s", g_audio_file_load_error); }
+       if (g_recorder_error[0] != '\0') { ImGui::TextColored(ImVec4(1.f, 0.f, 0.f, 1.f), "Recorder Error: %s", g_recorder_error); }
       ImGui::End();
     }
 
@@ -401,70 +535,73 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
     HRESULT hr = g_pSwapChain->Present(1, 0); 
     g_SwapChainOccluded = (hr == DXGI_STATUS_OCCLUDED);
 
-    if (!g_playback_active && immediateMode) {
+    if (g_playback_active) {
+        double current_playback_elapsed_time = g_timeSinceStart - g_playback_start_time_global;
+        // k-way merge over the track cursors, each due event costs O(log tracks)
+        while (!g_track_heap.empty() && current_playback_elapsed_time >= g_track_heap.top().timestamp) {
+            TrackCursor cursor = g_track_heap.top(); g_track_heap.pop();
+            HapticTrack& track = g_tracks[cursor.track_index];
+            const HapticEvent& event = track.events[track.next_event_index];
+            MixEvent(event.hand_id, event.finger_id, event.strength, event.duration, track.priority, cursor.track_index);
+            if (++track.next_event_index < track.events.size()) {
+                g_track_heap.push({track.events[track.next_event_index].timestamp, cursor.track_index});
+            }
+        }
+    }
+
+    if (immediateMode) {
         double current_time = g_timeSinceStart;
-        auto process_hand_manual = [&](serialib& hand_serial, std::vector<FingerConfig>& fingers_vec, const char* hand_tag) {
+        auto process_hand_manual = [&](serialib& hand_serial, std::vector<FingerConfig>& fingers_vec, int hand_id) {
             if (hand_serial.isDeviceOpen()) {
                 for (FingerConfig &finger : fingers_vec) { 
                     if (finger.Strength > 0 && (finger.LastWriteTime + g_immediateModeDuration < current_time || finger.LastWriteTime == 0.0)) {
-                        uint8_t writeBuffer[8]; writeBuffer[0] = static_cast<uint8_t>(finger.Location); writeBuffer[1] = static_cast<uint8_t>(finger.Strength);
-                        float duration_to_send = g_immediateModeDuration; std::memcpy(&writeBuffer[2], &duration_to_send, sizeof(float)); std::memcpy(&writeBuffer[6], paddingBuffer, 2);
-                        if (hand_serial.writeBytes(writeBuffer, 8) > 0) finger.LastWriteTime = current_time;
-                        else ImGui::DebugLog("%s: Write Fail %s\n", hand_tag, GetFingerText(finger.Location).c_str());
+                        MixEvent(hand_id, static_cast<uint8_t>(finger.Location), finger.Strength, g_immediateModeDuration, g_manual_priority, MANUAL_SOURCE); // LastWriteTime is set once it is actually sent
                     }
                 }
             }
         };
-        process_hand_manual(leftHand, g_leftHandFingers, "L");
-        process_hand_manual(rightHand, g_rightHandFingers, "R");
+        process_hand_manual(leftHand, g_leftHandFingers, 0);
+        process_hand_manual(rightHand, g_rightHandFingers, 1);
     }
 
-    if (g_playback_active) {
-        double current_playback_elapsed_time = g_timeSinceStart - g_playback_start_time_global;
-        bool all_haptics_done = true; 
-
-        if (g_next_event_index < g_scheduled_events.size()) {
-            all_haptics_done = false; 
-            while (g_next_event_index < g_scheduled_events.size() && current_playback_elapsed_time >= g_scheduled_events[g_next_event_index].timestamp) {
-                const HapticEvent& event = g_scheduled_events[g_next_event_index];
-                serialib* target_hand_serial = nullptr; const char* hand_name_debug = "";
-                if (event.hand_id == 0 && leftHand.isDeviceOpen()) { target_hand_serial = &leftHand; hand_name_debug = "Left"; }
-                else if (event.hand_id == 1 && rightHand.isDeviceOpen()) { target_hand_serial = &rightHand; hand_name_debug = "Right"; }
-
-                if (target_hand_serial) {
-                    uint8_t writeBuffer[8]; writeBuffer[0] = event.finger_id; writeBuffer[1] = event.strength;
-                    float duration_to_send = event.duration; std::memcpy(&writeBuffer[2], &duration_to_send, sizeof(float)); std::memcpy(&writeBuffer[6], paddingBuffer, 2);
-                    if (target_hand_serial->writeBytes(writeBuffer, 8) == 0) {
-                        ImGui::DebugLog("Playback: Failed to write to %s Hand for event at %.3fs (F:%d,S:%d,D:%.3f)\n", hand_name_debug, event.timestamp, event.finger_id, event.strength, event.duration);
-                    }
-                }
-                g_next_event_index++;
-            }
-            if(g_next_event_index >= g_scheduled_events.size()){
-                all_haptics_done = true; 
-            }
-        }
+    FlushMixSlots(leftHand, rightHand);
 
+    if (g_recorder_writer.joinable() && g_recorder_writer_done) {
+        g_recorder_writer.join();
+        g_recording_active = false; // The writer gives up early when the file cannot be written
+        if (g_recorder_write_failed) {
+            std::string err_msg = "Failed to write " + g_recording_file + ", recording stopped.";
+            strncpy_s(g_recorder_error, err_msg.c_str(), sizeof(g_recorder_error) - 1);
+            ImGui::DebugLog("Recorder: %s\n", err_msg.c_str());
+        }
+        else { ImGui::DebugLog("Recorder: Saved %zu packets to %s (%zu dropped). Refresh haptic files to play it.\n", g_recorded_packet_count, g_recording_file.c_str(), g_recorder_dropped_count); }
+    }
 
+    if (g_playback_active) {
+        bool all_haptics_done = g_track_heap.empty();
         bool audio_still_playing = false;
-        if (g_is_current_song_sound_initialized) {
-            audio_still_playing = ma_sound_is_playing(&g_current_song_sound);
+        bool any_track_content = false;
+        for (HapticTrack& track : g_tracks) {
+            if (track.is_sound_initialized && ma_sound_is_playing(&track.sound)) audio_still_playing = true;
+            if (!track.events.empty() || track.is_sound_initialized) any_track_content = true;
         }
 
-        if (all_haptics_done && (!g_is_current_song_sound_initialized || !audio_still_playing)) {
-            if (!g_scheduled_events.empty() || g_is_current_song_sound_initialized) { 
-                 ImGui::DebugLog("Playback automatically finished for %s.\n", g_currently_playing_file.c_str());
+        if (all_haptics_done && !audio_still_playing) {
+            if (any_track_content) { 
+                 ImGui::DebugLog("Playback automatically finished for %zu track(s).\n", g_tracks.size());
             }
-            g_playback_active = false; 
-            StopAndUnloadAudio();
-            g_currently_playing_file = "";
+            StopPlayback();
         }
     }
   } 
 
+  // Both log through ImGui, so they have to run before the context is destroyed
+  StopRecording();
+  if (g_recorder_writer.joinable()) g_recorder_writer.join();
+  StopAndUnloadAudio(); 
+
   ImGui_ImplDX11_Shutdown(); ImGui_ImplWin32_Shutdown(); ImGui::DestroyContext();
   
-  StopAndUnloadAudio(); 
   ma_engine_uninit(&g_audio_engine); 
 
   if(leftHand.isDeviceOpen()) leftHand.closeDevice(); if(rightHand.isDeviceOpen()) rightHand.closeDevice();
@@ -499,8 +636,8 @@ void RefreshHapticFileList() {
     }
 }
 
-bool LoadHapticEvents(const std::string& haptic_filename_without_path) {
-    g_scheduled_events.clear(); g_haptic_file_load_error[0] = '\0';
+bool LoadHapticEvents(const std::string& haptic_filename_without_path, std::vector<HapticEvent>& out_events) {
+    out_events.clear(); g_haptic_file_load_error[0] = '\0';
     fs::path file_path = fs::current_path() / g_haptic_files_directory / haptic_filename_without_path;
     std::ifstream file_stream(file_path);
     if (!file_stream.is_open()) {
@@ -522,11 +659,11 @@ bool LoadHapticEvents(const std::string& haptic_filename_without_path) {
             event.strength = item["strength"].get<uint8_t>();
             if (!item.contains("duration") || !item["duration"].is_number()) { ImGui::DebugLog("Skipping event at %.3f: missing or invalid duration.\n", event.timestamp); continue; }
             event.duration = item["duration"].get<float>();
-            g_scheduled_events.push_back(event);
+            out_events.push_back(event);
         }
-        std::sort(g_scheduled_events.begin(), g_scheduled_events.end());
-        ImGui::DebugLog("Loaded %zu haptic events from %s.\n", g_scheduled_events.size(), haptic_filename_without_path.c_str());
-        if(g_scheduled_events.empty() && j.is_array() && !j.empty()){ 
+        std::sort(out_events.begin(), out_events.end());
+        ImGui::DebugLog("Loaded %zu haptic events from %s.\n", out_events.size(), haptic_filename_without_path.c_str());
+        if(out_events.empty() && j.is_array() && !j.empty()){ 
              strncpy_s(g_haptic_file_load_error, "Haptic file parsed but no valid events found (check format).", sizeof(g_haptic_file_load_error) -1);
         }
         return true;
@@ -542,8 +679,8 @@ bool LoadHapticEvents(const std::string& haptic_filename_without_path) {
     }
 }
 
-bool LoadAndPrepareAudio(const std::string& haptic_filename_without_path) {
-    StopAndUnloadAudio(); 
+bool LoadAndPrepareAudio(const std::string& haptic_filename_without_path, HapticTrack& track) {
+    if (track.is_sound_initialized) { ma_sound_uninit(&track.sound); track.is_sound_initialized = false; }
     g_audio_file_load_error[0] = '\0'; 
 
     std::string base_filename = haptic_filename_without_path;
@@ -578,29 +715,181 @@ bool LoadAndPrepareAudio(const std::string& haptic_filename_without_path) {
     }
 
     ma_uint32 flags = MA_SOUND_FLAG_DECODE; // Explicitly decode the whole file
-    ma_result result = ma_sound_init_from_file(&g_audio_engine, audio_path_to_load.string().c_str(), flags, NULL, NULL, &g_current_song_sound);
+    ma_result result = ma_sound_init_from_file(&g_audio_engine, audio_path_to_load.string().c_str(), flags, NULL, NULL, &track.sound);
     if (result != MA_SUCCESS) {
         std::string err_msg = "Failed to load audio file '" + audio_path_to_load.filename().string() + "': " + ma_result_description(result);
         strncpy_s(g_audio_file_load_error, err_msg.c_str(), sizeof(g_audio_file_load_error) - 1);
         ImGui::DebugLog("%s\n", err_msg.c_str());
-        g_is_current_song_sound_initialized = false;
+        track.is_sound_initialized = false;
         return false;
     }
 
     ImGui::DebugLog("Audio file loaded: %s\n", audio_path_to_load.filename().string().c_str());
-    g_is_current_song_sound_initialized = true;
+    track.is_sound_initialized = true;
     return true;
 }
 
 void StopAndUnloadAudio() {
-    if (g_is_current_song_sound_initialized) {
-        if (ma_sound_is_playing(&g_current_song_sound)) {
-            ma_sound_stop(&g_current_song_sound);
+    for (HapticTrack& track : g_tracks) {
+        if (track.is_sound_initialized) {
+            if (ma_sound_is_playing(&track.sound)) {
+                ma_sound_stop(&track.sound);
+            }
+            ma_sound_uninit(&track.sound); 
+            track.is_sound_initialized = false;
+            ImGui::DebugLog("Audio unloaded for %s.\n", track.file.c_str());
+        }
+    }
+}
+
+void StopPlayback() {
+    g_playback_active = false;
+    StopAndUnloadAudio();
+    g_track_heap = {};
+    if (g_single_file_playback) {
+        g_tracks.clear();
+        g_single_file_playback = false;
+    }
+}
+
+void MixEvent(int hand_id, uint8_t finger_id, int strength, float duration, int priority, int source) {
+    if (hand_id < 0 || hand_id >= NUM_HANDS || finger_id >= NUM_FINGERS_PER_HAND) {
+        ImGui::DebugLog("Mixer: Dropping event for invalid target (H:%d,F:%d)\n", hand_id, finger_id); return;
+    }
+    MixSlot& slot = g_mix_slots[hand_id][finger_id];
+    MixContribution contribution; contribution.source = source; contribution.strength = strength; contribution.duration = duration; contribution.priority = priority;
+    for (MixContribution& pending : slot.pending) {
+        if (pending.source == source) { pending = contribution; return; } // Later event of the same source replaces the earlier one
+    }
+    slot.pending.push_back(contribution);
+}
+
+// True if challenger takes the finger over from holder under the Max or Priority policy
+bool WinsMix(EMixPolicy Policy, const MixContribution& challenger, const MixContribution& holder) {
+    if (Policy == EMixPolicy::Priority && challenger.priority != holder.priority) return challenger.priority > holder.priority;
+    return challenger.strength >= holder.strength;
+}
+
+// Re-evaluates every finger against all contributions still authored to play and sends a packet only when the glove output has to change
+void FlushMixSlots(serialib& leftHand, serialib& rightHand) {
+    serialib* hands[NUM_HANDS] = {&leftHand, &rightHand};
+    const char* hand_names_debug[NUM_HANDS] = {"Left", "Right"};
+    double current_time = g_timeSinceStart;
+    for (int hand_id = 0; hand_id < NUM_HANDS; ++hand_id) {
+        for (int finger_id = 0; finger_id < NUM_FINGERS_PER_HAND; ++finger_id) {
+            MixSlot& slot = g_mix_slots[hand_id][finger_id];
+            if (slot.pending.empty() && slot.active.empty()) continue;
+
+            // A source's newer event replaces its earlier contribution
+            bool manual_pending = false;
+            for (MixContribution& pending : slot.pending) {
+                slot.active.erase(std::remove_if(slot.active.begin(), slot.active.end(), [&](const MixContribution& active) { return active.source == pending.source; }), slot.active.end());
+                pending.expiry = current_time + pending.duration;
+                slot.active.push_back(pending);
+                if (pending.source == MANUAL_SOURCE) manual_pending = true;
+            }
+            slot.pending.clear();
+            slot.active.erase(std::remove_if(slot.active.begin(), slot.active.end(), [&](const MixContribution& active) { return active.expiry <= current_time; }), slot.active.end());
+            if (slot.active.empty()) continue; // The glove runs out on its own
+
+            // What the finger should be playing right now, and until when
+            EMixPolicy policy = g_finger_mix_policy[finger_id];
+            int strength = 0; double expiry = 0.0; bool manual_included = manual_pending;
+            if (policy == EMixPolicy::SumClamp) {
+                for (const MixContribution& active : slot.active) { strength += active.strength; expiry = max(expiry, active.expiry); }
+                strength = min(255, strength); // Re-sent with the remaining sum whenever a share expires
+            } else {
+                const MixContribution* winner = &slot.active[0];
+                for (const MixContribution& active : slot.active) { if (WinsMix(policy, active, *winner)) winner = &active; } // Newest wins ties
+                strength = winner->strength; expiry = winner->expiry; manual_included = manual_pending && winner->source == MANUAL_SOURCE;
+            }
+            if (strength == slot.sent_strength && expiry == slot.sent_expiry) continue; // Already playing on the glove
+            if (!hands[hand_id]->isDeviceOpen()) continue;
+
+            uint8_t writeBuffer[8]; writeBuffer[0] = static_cast<uint8_t>(finger_id); writeBuffer[1] = static_cast<uint8_t>(strength);
+            float duration_to_send = static_cast<float>(expiry - current_time); std::memcpy(&writeBuffer[2], &duration_to_send, sizeof(float)); std::memcpy(&writeBuffer[6], paddingBuffer, 2);
+            if (hands[hand_id]->writeBytes(writeBuffer, 8) <= 0) {
+                ImGui::DebugLog("Mixer: Failed to write to %s Hand (F:%d,S:%d,D:%.3f)\n", hand_names_debug[hand_id], finger_id, strength, duration_to_send);
+                continue;
+            }
+            RecordPacket(hand_id, writeBuffer[0], writeBuffer[1], duration_to_send);
+            slot.sent_strength = strength; slot.sent_expiry = expiry;
+            if (manual_included) { (hand_id == 0 ? g_leftHandFingers : g_rightHandFingers)[finger_id].LastWriteTime = current_time; }
+        }
+    }
+}
+
+void StartRecording() {
+    if (g_recording_active || g_recorder_writer.joinable()) return;
+    auto now = std::chrono::system_clock::now();
+    std::time_t now_seconds = std::chrono::system_clock::to_time_t(now); std::tm local_time; localtime_s(&local_time, &now_seconds);
+    int now_milliseconds = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+    std::ostringstream name_stream; name_stream << "recording_" << std::put_time(&local_time, "%Y%m%d_%H%M%S") << "_" << std::setw(3) << std::setfill('0') << now_milliseconds;
+    std::string base_name = name_stream.str();
+    g_recording_file = base_name + "_haptics.json";
+    for (int suffix = 2; fs::exists(fs::current_path() / g_haptic_files_directory / g_recording_file); ++suffix) { // Never truncate an earlier take
+        g_recording_file = base_name + "_" + std::to_string(suffix) + "_haptics.json";
+    }
+    g_recorded_packet_count = 0; g_recorder_dropped_count = 0;
+    g_recorder_head = 0; g_recorder_tail = 0;
+    g_recorder_writer_done = false; g_recorder_write_failed = false; g_recorder_error[0] = '\0';
+    g_recording_start_time = std::chrono::steady_clock::now();
+    g_recording_active = true;
+    g_recorder_writer = std::thread(RecorderWriterThread, fs::current_path() / g_haptic_files_directory / g_recording_file);
+    ImGui::DebugLog("Recorder: Started %s\n", g_recording_file.c_str());
+}
+
+// The writer thread drains what is left in the ring and closes the file on its own
+void StopRecording() {
+    if (!g_recording_active) return;
+    g_recording_active = false;
+    ImGui::DebugLog("Recorder: Stopped after %zu packets.\n", g_recorded_packet_count);
+}
+
+// Called from the frame thread only, never blocks: a full ring drops the packet instead
+void RecordPacket(int hand_id, uint8_t finger_id, uint8_t strength, float duration) {
+    if (!g_recording_active.load(std::memory_order_relaxed)) return;
+    size_t head = g_recorder_head.load(std::memory_order_relaxed);
+    if (head - g_recorder_tail.load(std::memory_order_acquire) >= g_recorder_capacity) { g_recorder_dropped_count++; return; }
+    HapticEvent& event = g_recorder_ring[head & (g_recorder_capacity - 1)];
+    event.timestamp = std::chrono::duration<double>(std::chrono::steady_clock::now() - g_recording_start_time).count();
+    event.hand_id = hand_id; event.finger_id = finger_id; event.strength = strength; event.duration = duration;
+    g_recorder_head.store(head + 1, std::memory_order_release);
+    g_recorded_packet_count++;
+}
+
+// Streams the ring into a .json array in the same format LoadHapticEvents reads
+void RecorderWriterThread(fs::path file_path) {
+    std::ofstream file_stream(file_path);
+    if (!file_stream.is_open()) { g_recorder_write_failed = true; g_recorder_writer_done = true; return; }
+    file_stream << std::fixed << "[";
+    bool first_event = true;
+    while (true) {
+        bool stopping = !g_recording_active.load(std::memory_order_acquire); // Read before draining so no late packet is missed
+        size_t tail = g_recorder_tail.load(std::memory_order_relaxed);
+        size_t head = g_recorder_head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const HapticEvent& event = g_recorder_ring[tail & (g_recorder_capacity - 1)];
+            file_stream << (first_event ? "\n" : ",\n")
+                        << "    {\n"
+                        << "        \"timestamp\": " << std::setprecision(4) << event.timestamp << ",\n"
+                        << "        \"hand_id\": " << event.hand_id << ",\n"
+                        << "        \"finger_id\": " << static_cast<int>(event.finger_id) << ",\n"
+                        << "        \"strength\": " << static_cast<int>(event.strength) << ",\n"
+                        << "        \"duration\": " << std::setprecision(3) << event.duration << "\n"
+                        << "    }";
+            first_event = false;
         }
-        ma_sound_uninit(&g_current_song_sound); 
-        g_is_current_song_sound_initialized = false;
-        ImGui::DebugLog("Audio unloaded.\n");
+        g_recorder_tail.store(tail, std::memory_order_release);
+        if (stopping) break;
+        file_stream.flush();
+        if (file_stream.fail()) { g_recorder_write_failed = true; g_recorder_writer_done = true; return; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
     }
+    file_stream << "\n]\n";
+    file_stream.close();
+    if (file_stream.fail()) { g_recorder_write_failed = true; }
+    g_recorder_writer_done = true;
 }
 
 
@@ -646,6 +935,13 @@ bool LoadTextureFromFile(const char *file_name, ID3D11ShaderResourceView **out_s
     size_t read_size = fread(file_data, 1, file_size, f); fclose(f); if(read_size != file_size) { IM_FREE(file_data); ImGui::DebugLog("Failed to read texture file: %s\n", file_name); return false;}
     bool ret_val = LoadTextureFromMemory(file_data, file_size, out_srv, out_width, out_height); IM_FREE(file_data); return ret_val;
 }
+std::string GetMixPolicyText(EMixPolicy Policy) {
+  switch (Policy) {
+  case EMixPolicy::Max: return "Max"; case EMixPolicy::Priority: return "Priority";
+  case EMixPolicy::SumClamp: return "Sum (Clamp)";
+  default: return "Unknown";
+  }
+}
 std::string GetFingerText(ETargetHandLocation Location) {
   switch (Location) {
   case ETargetHandLocation::Thumb: return "Thumb"; case ETargetHandLocation::Index: return "Index";